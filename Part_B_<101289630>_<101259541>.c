@@ -1,5 +1,6 @@
+#define _GNU_SOURCE             // for CPU_SET and sched_setaffinity
 #include <stdio.h>      // for printf, fopen, fgets, fclose
-#include <stdlib.h>     // for exit, atoi, rand, srand
+#include <stdlib.h>     // for exit, atoi, rand_r, malloc
 #include <string.h>     // for memset, strncpy, strlen, strchr
 #include <unistd.h>     // for fork, usleep, getpid
 #include <sys/ipc.h>    // shared memory key creation
@@ -7,8 +8,12 @@
 #include <sys/sem.h>    // for semaphores
 #include <sys/types.h>  // for pid_t, system types
 #include <sys/wait.h>   // for wait
-#include <time.h>       // for time
+#include <time.h>       // for time, clock_gettime
 #include <errno.h>      // for error handling
+#include <getopt.h>     // for getopt_long
+#include <ucontext.h>   // coroutines for simulation mode
+#include <sched.h>      // for sched_setaffinity
+#include <sys/syscall.h> // for SYS_mbind
 
 // some constants
 #define MAX_RUBRIC_LINES 5      // makes sure there are only 5 lines in rubric
@@ -21,32 +26,256 @@
 #define Q_PROGRESSING   1       // question being marked by TA
 #define Q_CORRECTED     2       // question marking done
 
+// batched question claiming
+#define MAX_CLAIM_BATCH     MAX_RUBRIC_LINES  // most questions one TA can hold at once
+#define BATCH_OVERHEAD_DIV  16      // aim for lock wait <= 1/16 of marking time per question
+
+// phases timed for each TA
+#define PHASE_RUBRIC    0       // one pass over the rubric
+#define PHASE_MARK      1       // marking one question
+#define PHASE_LOAD      2       // loading the next exam
+#define PHASE_LOCK      3       // blocked on a semaphore another TA holds
+#define PHASE_IDLE      4       // waiting on sem_work for the next exam
+#define NUM_PHASES      5
+
+// log-linear latency histogram: 8 sub-buckets per power of two,
+// values in microseconds up to 2^32 (about 71 minutes)
+#define HIST_SUB_BITS   3
+#define HIST_SUB_COUNT  (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS    ((32 - HIST_SUB_BITS + 1) * HIST_SUB_COUNT)
+
+// semaphore slots, used in traces and as semaphore ids in simulation mode
+#define SEM_RUBRIC      0
+#define SEM_QUESTION    1
+#define SEM_EXAM        2
+#define SEM_WORK        3
+#define NUM_SEMS        4
+
+#define TRACE_CAP       65536   // semaphore grants kept by --record
+#define AUDIT_LEN       256     // most recent rubric changes kept in the audit trail
+
+// shared memory arena for exam answers
+#define ARENA_SIZE      (64 * 1024)  // bytes, whatever number of exams pass through
+#define ARENA_ALIGN     8       // block sizes are rounded up to this
+#define ARENA_NONE      0xffffffffu  // null arena offset
+#define SIM_STACK_SIZE  (64 * 1024)  // coroutine stack per simulated TA
+
+// TA placement and shared memory layout
+#define CACHE_LINE      64      // keep hot shared fields on separate lines
+#define PAGE_BYTES       4096    // each TA stats slot starts on its own page
+#define MAX_NODES       64      // NUMA nodes looked for in sysfs
+#define PIN_NONE        0       // let the scheduler move TAs around
+#define PIN_CPU         1       // one CPU per TA, round robin
+#define PIN_NODE        2       // all CPUs of one NUMA node per TA, round robin
+
+// mbind() policies, normally from <numaif.h> (libnuma)
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED  1
+#define MPOL_BIND       2
+#define MPOL_INTERLEAVE 3
+#define MPOL_LOCAL      4
+#endif
+
 // some global variables
 static char rubric_path[256];       // path to rubric file
 static char exam_files[MAX_EXAMS][256];  // paths to exam files 
 static int  num_exams = 0;      // number of exam files
+static int  synthetic_exams = 0; // exams are generated, not read from files (--exams)
+static int  quiet = 0;          // suppress per step TA output (--quiet)
+static int  sim_mode = 0;       // TAs run as coroutines under a virtual clock (--sim)
+static int  pin_mode = PIN_NONE; // TA CPU placement (--pin)
+static int  mem_policy = -1;    // MPOL_* for the segment, -1 = kernel default (--mempolicy)
+static int  mem_node = -1;      // node for bind / preferred policies
+static int  use_hugepages = 0;  // back the segment with huge pages (--hugepages)
+static int  mark_min_ms = 1000; // marking time per question (--mark-ms)
+static int  mark_max_ms = 2000;
+static long long sim_lock_us = 0; // virtual time a claim/complete holds sem_question (--lock-us)
+
+// TA progress output, silenced by --quiet
+#define LOG(...) do { if (!quiet) printf(__VA_ARGS__); } while (0)
+
+static const char *phase_names[NUM_PHASES] = {"rubric", "mark", "load", "lock", "idle"};
+
+// latency histogram for one phase
+typedef struct {
+    unsigned long long count;       // samples recorded
+    unsigned long long total_us;    // sum of all samples
+    unsigned long long max_us;      // largest sample
+    unsigned long long buckets[HIST_BUCKETS];
+} LatencyHist;
+
+// per-TA stats slot, only ever written by its own TA.
+// page aligned so a pinned TA can first touch its own slot on its own node.
+typedef struct {
+    int          pid;
+    unsigned int seed;          // random seed the TA started with, for replay
+    LatencyHist  phase[NUM_PHASES];
+} __attribute__((aligned(PAGE_BYTES))) TAStats;
+
+// one semaphore grant, stored in the order grants happened
+typedef struct {
+    int ta;
+    int sem;
+} TraceEntry;
+
+// header in front of every arena block. blocks are found by offset,
+// not pointer, since each process maps the segment at its own address.
+typedef struct {
+    unsigned int size;          // block size including this header
+    unsigned int next;          // next free block by offset, ARENA_NONE at the end
+} ArenaBlock;
+
+// one rubric correction, for the audit trail
+typedef struct {
+    int          ta;            // TA that made the change
+    int          line;          // rubric line, 0 based
+    unsigned int version;       // line version after the change
+    int          exam_index;    // exam being marked at the time
+    long long    at_us;         // when it happened
+    char         text[MAX_LINE_LEN];  // line after the change
+} RubricChange;
 
 // shared data structure
 typedef struct {
     char rubric[MAX_RUBRIC_LINES][MAX_LINE_LEN];
+    unsigned int rubric_version[MAX_RUBRIC_LINES];  // bumped on every change to a line
     char current_student[STUDENT_LEN];  // ex : "1024"
-    int  question_state[MAX_RUBRIC_LINES]; // question marking state
-    int  current_exam_index;    // index of current exam being processed
+    // written on every claim, so kept off the mostly read rubric lines
+    int  question_state[MAX_RUBRIC_LINES] __attribute__((aligned(CACHE_LINE)));
+    unsigned int answer_off[MAX_RUBRIC_LINES]; // arena offset of each answer, ARENA_NONE if missing
+    unsigned int answer_len[MAX_RUBRIC_LINES]; // answer length, without the '\0'
+    // read by every TA on every loop, so kept off the question_state line
+    int  current_exam_index __attribute__((aligned(CACHE_LINE)));
     int  terminate;             // flag to signal TAs to exit when student ID 9999 is reached
+    int  idle_tas;              // TAs waiting on sem_work for the next exam, under sem_question
+    int  num_tas;               // number of TA processes sharing the segment
+    long long start_us;         // monotonic time the run started
+    int  audit_count;           // rubric changes made so far
+    RubricChange audit[AUDIT_LEN];  // ring of the latest changes, under sem_rubric
+    // answer arena, all under sem_question
+    unsigned int exam_block;    // arena block holding the loaded exam's answers
+    unsigned int arena_top;     // bump pointer; nothing at or above it is in use
+    unsigned int arena_free;    // free blocks below arena_top, sorted by offset
+    unsigned int arena_used;    // bytes in live blocks
+    unsigned int arena_peak;    // most bytes ever in live blocks
+    char arena[ARENA_SIZE] __attribute__((aligned(CACHE_LINE)));
+    int  trace_cap;             // grants the trace area can hold (0 = not recording)
+    int  trace_len;             // grants recorded so far
+    TAStats ta_stats[];         // one slot per TA, then trace_cap TraceEntry
 } SharedData;
 
-// deals with sleeping for a random time between min_ms and max_ms milliseconds 
+// size of the shared segment for a given number of TAs and trace entries
+#define SHARED_SIZE(tas, cap) (sizeof(SharedData) + (size_t)(tas) * sizeof(TAStats) \
+                               + (size_t)(cap) * sizeof(TraceEntry))
+
+// trace area sits right after the stats slots
+#define TRACE_ENTRIES(sh) ((TraceEntry *)&(sh)->ta_stats[(sh)->num_tas])
+
+// per-TA state used to size question batches
+typedef struct {
+    int       k;                // questions to claim per lock acquisition
+    long long avg_wait_us;      // smoothed lock wait per claim + complete round
+    long long avg_mark_us;      // smoothed marking time per question
+} BatchTuner;
+
+// random state of the running TA. seeded from the pid in real runs and
+// from the simulation seed or a recorded trace in simulation mode.
+static unsigned int rng_state = 1;
+
+static int ta_rand(void)
+{
+    return rand_r(&rng_state);
+}
+
+// running TA (-1 in the parent) and the data it works on
+static int         cur_ta = -1;
+static SharedData *cur_sh = NULL;
+
+// simulation engine, defined after ta()
+static long long sim_clock_us = 0;     // virtual time in microseconds
+static void sim_sleep_us(long long us);
+static int  sim_sem_wait(int sem);
+static void sim_sem_signal(int sem);
+
+// sleep for us microseconds, on the virtual clock in simulation mode
+static void sleep_us(long long us)
+{
+    if (sim_mode) {
+        sim_sleep_us(us);
+    } else {
+        usleep((useconds_t)us);
+    }
+}
+
+// deals with sleeping for a random time between min_ms and max_ms milliseconds
 static void sleep_ms(int min_ms, int max_ms)
 {
     int range = max_ms - min_ms + 1;
-    int ms = min_ms + (rand() % range);
-    usleep(ms * 1000);  // convert to microseconds
+    int ms = min_ms + (ta_rand() % range);
+    sleep_us(ms * 1000LL);  // convert to microseconds
+}
+
+// real monotonic time in microseconds
+static long long wall_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+// current time in microseconds, virtual in simulation mode
+static long long now_us(void)
+{
+    return sim_mode ? sim_clock_us : wall_us();
+}
+
+// stats slot of the calling TA (NULL in the parent)
+static TAStats *my_stats = NULL;
+
+// histogram bucket for a value in microseconds
+static int hist_index(unsigned long long v)
+{
+    if (v > 0xffffffffULL) v = 0xffffffffULL;
+    if (v < HIST_SUB_COUNT) return (int)v;
+
+    int e = 63 - __builtin_clzll(v);   // position of highest set bit
+    int sub = (int)(v >> (e - HIST_SUB_BITS)) - HIST_SUB_COUNT;
+    return (e - HIST_SUB_BITS + 1) * HIST_SUB_COUNT + sub;
+}
+
+// largest value that falls into a bucket
+static unsigned long long hist_upper(int idx)
+{
+    if (idx < HIST_SUB_COUNT) return (unsigned long long)idx;
+
+    int e = idx / HIST_SUB_COUNT + HIST_SUB_BITS - 1;
+    unsigned long long top = (unsigned long long)(idx % HIST_SUB_COUNT + HIST_SUB_COUNT);
+    return ((top + 1) << (e - HIST_SUB_BITS)) - 1;
+}
+
+// record one sample for the calling TA.
+// each slot has a single writer, so relaxed atomics are enough to keep
+// a reader attached to the segment from seeing torn counters.
+static void record_phase(int phase, long long us)
+{
+    if (!my_stats) return;
+    if (us < 0) us = 0;
+
+    LatencyHist *h = &my_stats->phase[phase];
+    __atomic_fetch_add(&h->buckets[hist_index((unsigned long long)us)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->total_us, (unsigned long long)us, __ATOMIC_RELAXED);
+    if ((unsigned long long)us > h->max_us) {
+        __atomic_store_n(&h->max_us, (unsigned long long)us, __ATOMIC_RELAXED);
+    }
+    // count last so a reader never sees more samples than bucket entries
+    __atomic_fetch_add(&h->count, 1, __ATOMIC_RELEASE);
 }
 
 // semaphore IDs
 static int sem_rubric  = -1;   // protects rubric corrections + file I/O
 static int sem_question = -1;  // protects question_state[]
 static int sem_exam    = -1;   // protects current_exam_index + load_exam()
+static int sem_work    = -1;   // starts at 0; TAs with nothing to claim wait here
 
 // system V semaphores need this union for semctl() on some systems
 union semun {
@@ -67,14 +296,57 @@ static void sem_init_one(int semid, int value)
     }
 }
 
+// trace slot of a semaphore id
+static int sem_slot(int semid)
+{
+    if (sim_mode) return semid;
+    if (semid == sem_rubric) return SEM_RUBRIC;
+    if (semid == sem_question) return SEM_QUESTION;
+    if (semid == sem_work) return SEM_WORK;
+    return SEM_EXAM;
+}
+
+// append a grant to the trace when recording.
+// called while the semaphore is held, so grants of one semaphore
+// land in the trace in the order they happened.
+static void record_grant(int semid)
+{
+    SharedData *sh = cur_sh;
+    if (!sh || cur_ta < 0 || sh->trace_cap == 0) return;
+
+    int idx = __atomic_fetch_add(&sh->trace_len, 1, __ATOMIC_RELAXED);
+    if (idx < sh->trace_cap) {
+        TraceEntry *e = &TRACE_ENTRIES(sh)[idx];
+        e->ta = cur_ta;
+        e->sem = sem_slot(semid);
+    }
+}
+
 // p operation / wait / down
 static void sem_wait_one(int semid)
 {
     // semaphore 0, decrement by 1, defult flags
-    struct sembuf op = {0, -1, 0};  
-    if (semop(semid, &op, 1) == -1) {
-        perror("semop wait");
-        exit(EXIT_FAILURE);
+    struct sembuf op = {0, -1, 0};
+    long long t0 = now_us();
+    int blocked;
+    if (sim_mode) {
+        blocked = sim_sem_wait(semid);
+    } else {
+        // try without waiting first, so only contended waits get timed
+        struct sembuf try_op = {0, -1, IPC_NOWAIT};
+        blocked = semop(semid, &try_op, 1) == -1;
+        if (blocked && (errno != EAGAIN || semop(semid, &op, 1) == -1)) {
+            perror("semop wait");
+            exit(EXIT_FAILURE);
+        }
+    }
+    record_grant(semid);
+    // waiting for the next exam is idle time; any other wait that
+    // blocked is time lost to a lock another TA held
+    if (semid == sem_work) {
+        record_phase(PHASE_IDLE, now_us() - t0);
+    } else if (blocked) {
+        record_phase(PHASE_LOCK, now_us() - t0);
     }
 }
 
@@ -83,12 +355,172 @@ static void sem_signal_one(int semid)
 {
     // semaphore 0, increment by 1, defult flags
     struct sembuf op = {0, +1, 0};
-    if (semop(semid, &op, 1) == -1) {
+    if (sim_mode) {
+        sim_sem_signal(semid);
+    } else if (semop(semid, &op, 1) == -1) {
         perror("semop signal");
         exit(EXIT_FAILURE);
     }
 }
 
+// parse a sysfs cpulist such as "0-3,8-11" into a cpu set
+// (node lists use the same format)
+static void parse_cpulist(const char *s, cpu_set_t *set)
+{
+    CPU_ZERO(set);
+    while (*s && *s != '\n') {
+        char *end;
+        long lo = strtol(s, &end, 10);
+        if (end == s) break;
+
+        long hi = lo;
+        if (*end == '-') {
+            s = end + 1;
+            hi = strtol(s, &end, 10);
+        }
+        for (long c = lo; c <= hi && c < CPU_SETSIZE; c++) {
+            CPU_SET(c, set);
+        }
+        s = (*end == ',') ? end + 1 : end;
+    }
+}
+
+// CPUs of each NUMA node that we are allowed to run on.
+// returns the number of nodes found; one node with every allowed CPU
+// when sysfs has no NUMA information.
+static int numa_nodes(cpu_set_t nodes[], int ids[], const cpu_set_t *allowed)
+{
+    int n = 0;
+    for (int id = 0; id < MAX_NODES; id++) {
+        char path[64], buf[1024];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", id);
+        FILE *f = fopen(path, "r");
+        if (!f) continue;
+
+        if (fgets(buf, sizeof(buf), f)) {
+            parse_cpulist(buf, &nodes[n]);
+            CPU_AND(&nodes[n], &nodes[n], allowed);
+            if (CPU_COUNT(&nodes[n]) > 0) ids[n++] = id;
+        }
+        fclose(f);
+    }
+
+    if (n == 0) {
+        nodes[0] = *allowed;
+        ids[0] = 0;
+        n = 1;
+    }
+    return n;
+}
+
+// pin the calling TA according to --pin; children start with the
+// parent's affinity, so every TA computes the same layout
+static void pin_ta(int id)
+{
+    if (pin_mode == PIN_NONE) return;
+
+    cpu_set_t allowed, target;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == -1) {
+        perror("sched_getaffinity");
+        return;
+    }
+
+    CPU_ZERO(&target);
+    if (pin_mode == PIN_CPU) {
+        int want = id % CPU_COUNT(&allowed), seen = 0;
+        for (int c = 0; c < CPU_SETSIZE; c++) {
+            if (CPU_ISSET(c, &allowed) && seen++ == want) {
+                CPU_SET(c, &target);
+                LOG("[TA %d] Pinned to CPU %d.\n", id, c);
+                break;
+            }
+        }
+    } else {
+        cpu_set_t nodes[MAX_NODES];
+        int ids[MAX_NODES];
+        int n = numa_nodes(nodes, ids, &allowed);
+        target = nodes[id % n];
+        LOG("[TA %d] Pinned to node %d.\n", id, ids[id % n]);
+    }
+
+    if (sched_setaffinity(0, sizeof(target), &target) == -1) {
+        perror("sched_setaffinity");
+    }
+}
+
+// apply the --mempolicy to the segment. must run before anything
+// touches the pages, since placement happens on first touch.
+static int apply_mem_policy(void *addr, size_t len)
+{
+    if (mem_policy < 0) return 0;
+
+    unsigned long mask = 0;
+    if (mem_policy == MPOL_INTERLEAVE) {
+        // every node that has memory; memoryless nodes are left out
+        FILE *f = fopen("/sys/devices/system/node/has_memory", "r");
+        char buf[1024];
+        if (f && fgets(buf, sizeof(buf), f)) {
+            cpu_set_t nodes;
+            parse_cpulist(buf, &nodes);
+            for (int id = 0; id < MAX_NODES && id < (int)(8 * sizeof(mask)); id++) {
+                if (CPU_ISSET(id, &nodes)) mask |= 1UL << id;
+            }
+        }
+        if (f) fclose(f);
+        if (mask == 0) mask = 1;
+    } else if (mem_policy != MPOL_LOCAL) {
+        mask = 1UL << mem_node;
+    }
+
+    // the kernel reads maxnode - 1 bits of the mask
+    unsigned long maxnode = mem_policy == MPOL_LOCAL ? 0 : 8 * sizeof(mask) + 1;
+    long pg = sysconf(_SC_PAGESIZE);
+    if (pg <= 0) pg = PAGE_BYTES;
+    len = (len + pg - 1) / pg * pg;
+    if (syscall(SYS_mbind, addr, len, mem_policy,
+                mem_policy == MPOL_LOCAL ? NULL : &mask, maxnode, 0) == -1) {
+        perror("mbind");
+        return -1;
+    }
+    return 0;
+}
+
+// huge page size from /proc/meminfo, 0 if unknown
+static size_t huge_page_size(void)
+{
+    FILE *f = fopen("/proc/meminfo", "r");
+    if (!f) return 0;
+
+    char line[128];
+    size_t kb = 0;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "Hugepagesize: %zu kB", &kb) == 1) break;
+    }
+    fclose(f);
+    return kb * 1024;
+}
+
+// parse --mempolicy: local, interleave, bind:N or preferred:N
+static int parse_mem_policy(const char *s)
+{
+    if (strcmp(s, "local") == 0) {
+        mem_policy = MPOL_LOCAL;
+    } else if (strcmp(s, "interleave") == 0) {
+        mem_policy = MPOL_INTERLEAVE;
+    } else if (sscanf(s, "bind:%d", &mem_node) == 1) {
+        mem_policy = MPOL_BIND;
+    } else if (sscanf(s, "preferred:%d", &mem_node) == 1) {
+        mem_policy = MPOL_PREFERRED;
+    } else {
+        return -1;
+    }
+    if (mem_policy != MPOL_LOCAL && mem_policy != MPOL_INTERLEAVE &&
+        (mem_node < 0 || mem_node >= MAX_NODES)) {
+        return -1;
+    }
+    return 0;
+}
+
 // load rubric from file into shared memory
 static int load_rubric(const char *path, SharedData *sh)
 {
@@ -110,6 +542,8 @@ static int load_rubric(const char *path, SharedData *sh)
                 sh->rubric[i][len - 1] = '\0';
             }
         }
+        // every TA starts at version 0, so all lines get one first review
+        sh->rubric_version[i] = sh->rubric[i][0] != '\0' ? 1 : 0;
     }
 
     fclose(f);
@@ -119,6 +553,9 @@ static int load_rubric(const char *path, SharedData *sh)
 // save rubric from shared memory back to file
 static int save_rubric(const char *path, SharedData *sh)
 {
+    // simulation never touches the rubric file
+    if (sim_mode) return 0;
+
     FILE *f = fopen(path, "w");
     if (!f) {
         perror("fopen rubric for write");
@@ -134,38 +571,248 @@ static int save_rubric(const char *path, SharedData *sh)
     return 0;
 }
 
-// load exam file into shared memory
+#define ARENA_BLOCK(sh, off) ((ArenaBlock *)&(sh)->arena[off])
+
+// empty arena with no exam answers loaded
+static void arena_init(SharedData *sh)
+{
+    sh->exam_block = ARENA_NONE;
+    sh->arena_top = 0;
+    sh->arena_free = ARENA_NONE;
+    for (int q = 0; q < MAX_RUBRIC_LINES; q++) {
+        sh->answer_off[q] = ARENA_NONE;
+        sh->answer_len[q] = 0;
+    }
+}
+
+// allocate size bytes from the arena, first fit from the free list and
+// bump allocation above it. returns the offset of the usable bytes, or
+// ARENA_NONE when the arena is full. caller holds sem_question.
+// only one exam is resident at a time and load_exam() frees it first, so
+// today there is at most one live block and the free list, splitting and
+// merging stay unused until more than one exam is resident.
+static unsigned int arena_alloc(SharedData *sh, size_t size)
+{
+    size_t need = (sizeof(ArenaBlock) + size + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN;
+    if (need > ARENA_SIZE) return ARENA_NONE;
+
+    unsigned int prev = ARENA_NONE, off = sh->arena_free;
+    while (off != ARENA_NONE && ARENA_BLOCK(sh, off)->size < need) {
+        prev = off;
+        off = ARENA_BLOCK(sh, off)->next;
+    }
+
+    ArenaBlock *b;
+    if (off != ARENA_NONE) {
+        // reuse a freed block, splitting off the tail when it is big enough
+        b = ARENA_BLOCK(sh, off);
+        unsigned int next = b->next;
+        if (b->size - need >= sizeof(ArenaBlock) + ARENA_ALIGN) {
+            unsigned int rest = off + (unsigned int)need;
+            ARENA_BLOCK(sh, rest)->size = b->size - (unsigned int)need;
+            ARENA_BLOCK(sh, rest)->next = next;
+            b->size = (unsigned int)need;
+            next = rest;
+        }
+        if (prev == ARENA_NONE) sh->arena_free = next;
+        else ARENA_BLOCK(sh, prev)->next = next;
+    } else {
+        if (ARENA_SIZE - sh->arena_top < need) return ARENA_NONE;
+        off = sh->arena_top;
+        b = ARENA_BLOCK(sh, off);
+        b->size = (unsigned int)need;
+        sh->arena_top += (unsigned int)need;
+    }
+
+    b->next = ARENA_NONE;
+    sh->arena_used += b->size;
+    if (sh->arena_used > sh->arena_peak) sh->arena_peak = sh->arena_used;
+    return off + (unsigned int)sizeof(ArenaBlock);
+}
+
+// return a block from arena_alloc(). neighbouring free blocks are merged
+// and a free block at the top goes back to the bump area. caller holds
+// sem_question.
+static void arena_free(SharedData *sh, unsigned int data_off)
+{
+    unsigned int off = data_off - (unsigned int)sizeof(ArenaBlock);
+    ArenaBlock *b = ARENA_BLOCK(sh, off);
+    sh->arena_used -= b->size;
+
+    // insert in offset order
+    unsigned int prev = ARENA_NONE, cur = sh->arena_free;
+    while (cur != ARENA_NONE && cur < off) {
+        prev = cur;
+        cur = ARENA_BLOCK(sh, cur)->next;
+    }
+    b->next = cur;
+    if (prev == ARENA_NONE) sh->arena_free = off;
+    else ARENA_BLOCK(sh, prev)->next = off;
+
+    // merge with the following block, then with the preceding one
+    if (cur != ARENA_NONE && off + b->size == cur) {
+        b->size += ARENA_BLOCK(sh, cur)->size;
+        b->next = ARENA_BLOCK(sh, cur)->next;
+    }
+    if (prev != ARENA_NONE && prev + ARENA_BLOCK(sh, prev)->size == off) {
+        ARENA_BLOCK(sh, prev)->size += b->size;
+        ARENA_BLOCK(sh, prev)->next = b->next;
+    }
+
+    // the last free block may end at the bump pointer; hand it back
+    prev = ARENA_NONE;
+    cur = sh->arena_free;
+    while (cur != ARENA_NONE && ARENA_BLOCK(sh, cur)->next != ARENA_NONE) {
+        prev = cur;
+        cur = ARENA_BLOCK(sh, cur)->next;
+    }
+    if (cur != ARENA_NONE && cur + ARENA_BLOCK(sh, cur)->size == sh->arena_top) {
+        sh->arena_top = cur;
+        if (prev == ARENA_NONE) sh->arena_free = ARENA_NONE;
+        else ARENA_BLOCK(sh, prev)->next = ARENA_NONE;
+    }
+}
+
+// drop the loaded exam's answers from the arena. caller holds sem_question.
+static void release_exam_answers(SharedData *sh)
+{
+    if (sh->exam_block != ARENA_NONE) {
+        arena_free(sh, sh->exam_block);
+        sh->exam_block = ARENA_NONE;
+    }
+    for (int q = 0; q < MAX_RUBRIC_LINES; q++) {
+        sh->answer_off[q] = ARENA_NONE;
+        sh->answer_len[q] = 0;
+    }
+}
+
+// answer to question q of the loaded exam, read in place from the arena,
+// with its length in *len. only valid while the caller has q claimed.
+static const char *exam_answer(SharedData *sh, int q, int *len)
+{
+    unsigned int off = sh->answer_off[q];
+    *len = off == ARENA_NONE ? 0 : (int)sh->answer_len[q];
+    return off == ARENA_NONE ? "" : &sh->arena[off];
+}
+
+// let every TA waiting on sem_work look again. caller holds sem_question.
+static void wake_idle_tas(SharedData *sh)
+{
+    for (; sh->idle_tas > 0; sh->idle_tas--) {
+        sem_signal_one(sem_work);
+    }
+}
+
+// set the terminate flag and wake waiting TAs so they can see it.
+// done under sem_question so no TA starts waiting right after.
+static void stop_tas(SharedData *sh)
+{
+    sem_wait_one(sem_question);
+    sh->terminate = 1;
+    wake_idle_tas(sh);
+    sem_signal_one(sem_question);
+}
+
+// load exam file into shared memory.
+// line 1 is the student number; the lines after it answer questions 1..5.
 static int load_exam(SharedData *sh, int exam_index)
 {
     if (exam_index < 0 || exam_index >= num_exams) {
         fprintf(stderr, "No more exams (index %d)\n", exam_index);
-        sh->terminate = 1;
+        stop_tas(sh);
         return -1;
     }
 
-    const char *path = exam_files[exam_index];
-    FILE *f = fopen(path, "r");
-    if (!f) {
-        perror("fopen exam");
-        sh->terminate = 1;
-        return -1;
-    }
-
-    // read first line → student number
     char buf[STUDENT_LEN];
-    if (!fgets(buf, sizeof(buf), f)) {
-        fprintf(stderr, "Exam file %s is empty\n", path);
+    char *answers[MAX_RUBRIC_LINES] = {0};
+    size_t answer_len[MAX_RUBRIC_LINES] = {0};
+    const char *path;
+
+    if (synthetic_exams) {
+        // generated exam: numbered students, last one is the 9999 sentinel
+        path = "generated";
+        int student = exam_index == num_exams - 1 ? 9999 : exam_index % 9998 + 1;
+        snprintf(buf, sizeof(buf), "%04d", student);
+
+        // generated answers, so simulated runs go through the arena too
+        for (int q = 0; q < MAX_RUBRIC_LINES; q++) {
+            char tmp[64];
+            int n = snprintf(tmp, sizeof(tmp), "answer %d of student %04d", q + 1, student);
+            answers[q] = strdup(tmp);
+            answer_len[q] = answers[q] ? (size_t)n : 0;
+        }
+    } else {
+        path = exam_files[exam_index];
+        FILE *f = fopen(path, "r");
+        if (!f) {
+            perror("fopen exam");
+            stop_tas(sh);
+            return -1;
+        }
+
+        // read first line → student number. the whole line is consumed,
+        // even past STUDENT_LEN, so answer 1 really is the next line
+        char *line = NULL;
+        size_t line_cap = 0;
+        if (getline(&line, &line_cap, f) < 0) {
+            fprintf(stderr, "Exam file %s is empty\n", path);
+            free(line);
+            fclose(f);
+            stop_tas(sh);
+            return -1;
+        }
+        strncpy(buf, line, sizeof(buf) - 1);
+        buf[sizeof(buf) - 1] = '\0';
+        free(line);
+
+        // one answer per line, any length
+        for (int q = 0; q < MAX_RUBRIC_LINES; q++) {
+            size_t cap = 0;
+            ssize_t n = getline(&answers[q], &cap, f);
+            if (n < 0) {
+                // getline may still have allocated a buffer; no answer here
+                free(answers[q]);
+                answers[q] = NULL;
+                break;
+            }
+            answers[q][strcspn(answers[q], "\r\n")] = '\0';
+            answer_len[q] = strlen(answers[q]);
+        }
         fclose(f);
-        sh->terminate = 1;
-        return -1;
     }
 
-    // remove newline from the student number line.
-    size_t len = strlen(buf);
-    if (len > 0 && buf[len - 1] == '\n') {
-        buf[len - 1] = '\0';
+    // remove newline (and a windows carriage return) from the student number line.
+    buf[strcspn(buf, "\r\n")] = '\0';
+
+    // answers go into one arena block; the exam is swapped in under the
+    // question semaphore so no TA claims a question halfway through
+    size_t total = 0;
+    for (int q = 0; q < MAX_RUBRIC_LINES; q++) {
+        if (answers[q]) total += answer_len[q] + 1;
+    }
+
+    sem_wait_one(sem_question);
+
+    // an exam replaced before all its questions were corrected still
+    // holds its block
+    release_exam_answers(sh);
+
+    unsigned int block = total > 0 ? arena_alloc(sh, total) : ARENA_NONE;
+    if (total > 0 && block == ARENA_NONE) {
+        fprintf(stderr, "Answer arena full; exam %d answers not loaded.\n", exam_index);
     }
 
+    unsigned int pos = block;
+    for (int q = 0; q < MAX_RUBRIC_LINES && block != ARENA_NONE; q++) {
+        if (!answers[q]) continue;
+        memcpy(&sh->arena[pos], answers[q], answer_len[q] + 1);
+        sh->answer_off[q] = pos;
+        sh->answer_len[q] = (unsigned int)answer_len[q];
+        pos += (unsigned int)answer_len[q] + 1;
+    }
+    sh->exam_block = block;
+    sh->current_exam_index = exam_index;
+
     // store student number into shared memory 
     strncpy(sh->current_student, buf, STUDENT_LEN - 1);
     sh->current_student[STUDENT_LEN - 1] = '\0';
@@ -175,112 +822,303 @@ static int load_exam(SharedData *sh, int exam_index)
         sh->question_state[i] = Q_UNTOUCHED;
     }
 
-    printf("[PARENT] Loaded exam %d (%s) student %s into shared memory.\n", exam_index, path, sh->current_student);
+    // check for sentinel student ID 9999 before waking anyone, so a
+    // woken TA never goes back to wait on the last exam
+    int last = atoi(sh->current_student) == 9999;
+    if (last) sh->terminate = 1;
+    wake_idle_tas(sh);
+
+    sem_signal_one(sem_question);
 
-    // check for sentinel student ID 9999
-    if (atoi(sh->current_student) == 9999) {
-        printf("[PARENT] student 9999 reached. TAs will exit.\n");
-        sh->terminate = 1;
+    for (int q = 0; q < MAX_RUBRIC_LINES; q++) {
+        free(answers[q]);
     }
 
-    fclose(f);
+    LOG("[PARENT] Loaded exam %d (%s) student %s into shared memory.\n", exam_index, path, sh->current_student);
+
+    if (last) {
+        LOG("[PARENT] student 9999 reached. TAs will exit.\n");
+    }
+
+    return 0;
+}
+
+// reserve up to k untouched questions in one critical section.
+// returns how many were picked; *all_done is set when every question is corrected,
+// with *exam_index the exam that was checked. when other TAs hold all the
+// rest, *must_wait is set and the caller has to wait on sem_work.
+// *waited gets the time spent blocked on the question semaphore.
+static int claim_questions(SharedData *sh, int picked[], int k, int *all_done,
+                           int *must_wait, int *exam_index, long long *waited)
+{
+    long long t0 = now_us();
+    sem_wait_one(sem_question);
+    *waited = now_us() - t0;
+    if (sim_lock_us > 0) sleep_us(sim_lock_us);
+
+    // leave a fair share of untouched questions for the other TAs
+    int untouched = 0;
+    for (int q = 0; q < MAX_RUBRIC_LINES; q++) {
+        if (sh->question_state[q] == Q_UNTOUCHED) untouched++;
+    }
+    int tas = sh->num_tas > 0 ? sh->num_tas : 1;
+    int share = (untouched + tas - 1) / tas;
+    if (k > share) k = share;
+    if (k < 1) k = 1;
+
+    int n = 0;
+    *all_done = 1;
+    *exam_index = sh->current_exam_index;
+    for (int q = 0; q < MAX_RUBRIC_LINES; q++) {
+        if (sh->question_state[q] == Q_UNTOUCHED && n < k) {
+            picked[n++] = q;
+            sh->question_state[q] = Q_PROGRESSING;
+        }
+        if (sh->question_state[q] != Q_CORRECTED) {
+            *all_done = 0;
+        }
+    }
+
+    // registered in the same critical section the exam was checked in,
+    // so the next load_exam() or stop_tas() is sure to wake us
+    *must_wait = n == 0 && !*all_done && !sh->terminate;
+    if (*must_wait) sh->idle_tas++;
+
+    sem_signal_one(sem_question);
+    return n;
+}
+
+// mark a batch of questions corrected in one critical section
+static void complete_questions(SharedData *sh, const int picked[], int n,
+                               long long *waited)
+{
+    long long t0 = now_us();
+    sem_wait_one(sem_question);
+    *waited = now_us() - t0;
+    if (sim_lock_us > 0) sleep_us(sim_lock_us);
+
+    for (int i = 0; i < n; i++) {
+        sh->question_state[picked[i]] = Q_CORRECTED;
+    }
+
+    // once every question is corrected nobody reads the answers again,
+    // so their block can be reused by the next exam
+    int all_done = 1;
+    for (int q = 0; q < MAX_RUBRIC_LINES; q++) {
+        if (sh->question_state[q] != Q_CORRECTED) all_done = 0;
+    }
+    if (all_done) release_exam_answers(sh);
+
+    sem_signal_one(sem_question);
+}
+
+// pick the next batch size from observed lock wait vs marking time.
+// when waiting on the lock is cheap next to marking, k stays at 1 so
+// questions spread across TAs; as lock cost grows, k grows with it.
+// with 1-2 s marking the wait has to average over ~60 ms before k moves,
+// so k stays at 1 in normal runs; --sim with --lock-us and a short
+// --mark-ms exercises larger batches.
+static void tune_batch(BatchTuner *bt, long long wait_us, long long mark_us, int n)
+{
+    long long per_q = mark_us / n;
+
+    // exponential moving average, weight 1/4 on the newest sample
+    if (bt->avg_mark_us == 0) {
+        bt->avg_wait_us = wait_us;
+        bt->avg_mark_us = per_q;
+    } else {
+        bt->avg_wait_us += (wait_us - bt->avg_wait_us) / 4;
+        bt->avg_mark_us += (per_q - bt->avg_mark_us) / 4;
+    }
+
+    long long mark = bt->avg_mark_us > 0 ? bt->avg_mark_us : 1;
+    long long k = (BATCH_OVERHEAD_DIV * bt->avg_wait_us + mark - 1) / mark;
+    if (k < 1) k = 1;
+    if (k > MAX_CLAIM_BATCH) k = MAX_CLAIM_BATCH;
+    bt->k = (int)k;
+}
+
+// has any rubric line changed since this TA last reviewed it?
+// read without the lock; review_rubric() checks again while holding it
+static int rubric_changed(SharedData *sh, const unsigned int seen[])
+{
+    for (int q = 0; q < MAX_RUBRIC_LINES; q++) {
+        if (__atomic_load_n(&sh->rubric_version[q], __ATOMIC_ACQUIRE) != seen[q]) return 1;
+    }
     return 0;
 }
 
+// bump a line's version after a correction and add it to the audit trail.
+// caller holds sem_rubric. returns the new version.
+static unsigned int note_rubric_change(SharedData *sh, int id, int q)
+{
+    unsigned int v = sh->rubric_version[q] + 1;
+    __atomic_store_n(&sh->rubric_version[q], v, __ATOMIC_RELEASE);
+
+    RubricChange *e = &sh->audit[sh->audit_count % AUDIT_LEN];
+    e->ta = id;
+    e->line = q;
+    e->version = v;
+    e->exam_index = sh->current_exam_index;
+    e->at_us = now_us();
+    strncpy(e->text, sh->rubric[q], MAX_LINE_LEN - 1);
+    e->text[MAX_LINE_LEN - 1] = '\0';
+    sh->audit_count++;
+    return v;
+}
+
+// review rubric lines changed since this TA's last visit, maybe correcting
+// some. seen[] holds the version of each line this TA last reviewed.
+static void review_rubric(int id, SharedData *sh, unsigned int seen[])
+{
+    sem_wait_one(sem_rubric);
+    long long rubric_start = now_us();
+    LOG("[TA %d] Checking rubric for student %s (exam %d).\n",
+           id, sh->current_student, sh->current_exam_index);
+
+    int changed = 0;
+    for (int q = 0; q < MAX_RUBRIC_LINES; q++) {
+        char *line = sh->rubric[q];
+        unsigned int v = sh->rubric_version[q];
+        if (line[0] == '\0' || v == seen[q]) continue;
+
+        LOG("[TA %d] Reviewing rubric line %d: '%s'\n",
+               id, q + 1, line);
+
+        sleep_ms(500, 1000);
+
+        // randomly decide to correct (25% chance)
+        if (ta_rand() % 4 == 0) {
+            char *comma = strchr(line, ',');
+            if (comma && comma[1] != '\0') {
+                char *c = &comma[1];
+                // increment the score by 1 to shift ascii value
+                (*c)++;
+                v = note_rubric_change(sh, id, q);
+                changed = 1;
+                LOG("[TA %d] Corrected rubric line %d -> '%s'\n",
+                       id, q + 1, line);
+            }
+        }
+        seen[q] = v;
+    }
+
+    // the file only needs rewriting when this pass changed something
+    if (changed) {
+        LOG("[TA %d] Writing rubric back to file: %s\n", id, rubric_path);
+        save_rubric(rubric_path, sh);
+    }
+    record_phase(PHASE_RUBRIC, now_us() - rubric_start);
+    sem_signal_one(sem_rubric);
+}
+
+// print the rubric audit trail, latest AUDIT_LEN changes
+static void print_audit(SharedData *sh)
+{
+    int n = sh->audit_count;
+    printf("[AUDIT] %d rubric change(s)", n);
+    if (n > AUDIT_LEN && !quiet) printf(", latest %d shown", AUDIT_LEN);
+    printf(".\n");
+    if (quiet) return;
+
+    int first = n > AUDIT_LEN ? n - AUDIT_LEN : 0;
+    for (int i = first; i < n; i++) {
+        RubricChange *e = &sh->audit[i % AUDIT_LEN];
+        printf("[AUDIT] t=%.1fs TA %d changed line %d to v%u (exam %d): '%s'\n",
+               (e->at_us - sh->start_us) / 1e6, e->ta, e->line + 1,
+               e->version, e->exam_index, e->text);
+    }
+}
+
 // TA process function
+// rng_state must already be seeded by the caller
 static void ta(int id, SharedData *sh)
 {
-    srand(getpid());
-    printf("[TA %d, PID %d] Started.\n", id, getpid());
+    cur_ta = id;
+    cur_sh = sh;
+    LOG("[TA %d, PID %d] Started.\n", id, getpid());
+
+    // this TA's slot in the shared stats area
+    my_stats = &sh->ta_stats[id];
+    my_stats->pid = getpid();
+    my_stats->seed = rng_state;
+
+    // start with one question per claim until lock cost has been measured
+    BatchTuner tuner = {1, 0, 0};
+
+    // rubric line versions this TA has reviewed; 0 means never
+    unsigned int seen[MAX_RUBRIC_LINES] = {0};
 
     while (1) {
         // check global terminate flag regularly
         if (sh->terminate) {
-            printf("[TA %d] Terminate flag set. Exiting.\n", id);
+            LOG("[TA %d] Terminate flag set. Exiting.\n", id);
             break;
         }
 
-        // rubric correction section 
-        sem_wait_one(sem_rubric);
-        printf("[TA %d] Checking rubric for student %s (exam %d).\n",
-               id, sh->current_student, sh->current_exam_index);
-
-        for (int q = 0; q < MAX_RUBRIC_LINES; q++) {
-            char *line = sh->rubric[q];
-            if (line[0] == '\0') continue;
-
-            printf("[TA %d] Reviewing rubric line %d: '%s'\n",
-                   id, q + 1, line);
-
-            sleep_ms(500, 1000);
-
-            // randomly decide to correct (25% chance)
-            if (rand() % 4 == 0) {
-                char *comma = strchr(line, ',');
-                if (comma && comma[1] != '\0') {
-                    char *c = &comma[1];
-                    // increment the score by 1 to shift ascii value
-                    (*c)++; 
-                    printf("[TA %d] Corrected rubric line %d -> '%s'\n",
-                           id, q + 1, line);
-                }
-            }
+        // rubric correction section, only for lines changed since
+        // this TA's last visit
+        if (rubric_changed(sh, seen)) {
+            review_rubric(id, sh, seen);
         }
-
-        printf("[TA %d] Writing rubric back to file: %s\n", id, rubric_path);
-        save_rubric(rubric_path, sh);
-        sem_signal_one(sem_rubric);
         // end rubric correction section
 
-        // marking questions
+        // marking questions in batches
         int all_done = 0;
+        int must_wait = 0;
+        int done_exam = -1;
 
         while (!all_done && !sh->terminate) {
 
-            int picked_q = -1;
+            int picked[MAX_CLAIM_BATCH];
+            long long claim_wait, done_wait;
 
-            // choose question to mark inside question semaphore and update state
-            sem_wait_one(sem_question);
+            // reserve a batch of questions inside question semaphore
+            int n = claim_questions(sh, picked, tuner.k, &all_done, &must_wait,
+                                    &done_exam, &claim_wait);
 
-            all_done = 1;
-            for (int q = 0; q < MAX_RUBRIC_LINES; q++) {
-                if (sh->question_state[q] == Q_UNTOUCHED) {
-                    picked_q = q;
-                    sh->question_state[q] = Q_PROGRESSING;
-                    all_done = 0;
-                    break;
-                }
-                if (sh->question_state[q] != Q_CORRECTED) {
-                    all_done = 0;
-                }
-            }
-
-            sem_signal_one(sem_question);
-            // end and update state
-
-            if (picked_q == -1) {
+            if (n == 0) {
                 if (all_done) {
-                    printf("[TA %d] All questions done for student %s.\n",
+                    LOG("[TA %d] All questions done for student %s.\n",
                            id, sh->current_student);
+                } else if (must_wait) {
+                    // the rest are being marked by other TAs; sleep until
+                    // the next exam is loaded or the run stops
+                    LOG("[TA %d] Other TAs hold the rest of student %s; waiting.\n",
+                           id, sh->current_student);
+                    sem_wait_one(sem_work);
                 }
                 break;
             }
 
-            printf("[TA %d] Marking student %s question %d...\n",
-                   id, sh->current_student, picked_q + 1);
-            sleep_ms(1000, 2000);
+            long long mark_start = now_us();
+            for (int i = 0; i < n; i++) {
+                // the answer is read in place; its block stays put until
+                // every question, including this one, is corrected
+                int len;
+                const char *answer = exam_answer(sh, picked[i], &len);
+                if (len > 60) len = 60;
+                LOG("[TA %d] Marking student %s question %d: '%.*s'...\n",
+                       id, sh->current_student, picked[i] + 1, len, answer);
+                long long q_start = now_us();
+                sleep_ms(mark_min_ms, mark_max_ms);
+                record_phase(PHASE_MARK, now_us() - q_start);
+            }
+            long long mark_time = now_us() - mark_start;
+
+            // report the whole batch as corrected inside question semaphore
+            complete_questions(sh, picked, n, &done_wait);
 
-            // mark completion inside question semaphore
-            sem_wait_one(sem_question);
-            sh->question_state[picked_q] = Q_CORRECTED;
-            sem_signal_one(sem_question);
+            for (int i = 0; i < n; i++) {
+                LOG("[TA %d] Finished marking student %s question %d.\n",
+                       id, sh->current_student, picked[i] + 1);
+            }
 
-            printf("[TA %d] Finished marking student %s question %d.\n",
-                   id, sh->current_student, picked_q + 1);
+            tune_batch(&tuner, claim_wait + done_wait, mark_time, n);
         }
 
         if (sh->terminate) {
-            printf("[TA %d] Terminate flag set after marking. Exiting.\n", id);
+            LOG("[TA %d] Terminate flag set after marking. Exiting.\n", id);
             break;
         }
 
@@ -288,64 +1126,715 @@ static void ta(int id, SharedData *sh)
         if (all_done && !sh->terminate) {
             sem_wait_one(sem_exam);
 
+            // another TA that also saw this exam finish may have loaded
+            // the next one already
+            if (sh->current_exam_index != done_exam) {
+                LOG("[TA %d] Exam %d was already replaced by another TA.\n",
+                       id, done_exam);
+                sem_signal_one(sem_exam);
+                continue;
+            }
+
             int next_exam = sh->current_exam_index + 1;
-            printf("[TA %d] Attempting to load next exam index %d.\n",
+            LOG("[TA %d] Attempting to load next exam index %d.\n",
                    id, next_exam);
 
             if (next_exam >= num_exams) {
-                printf("[TA %d] No more exams listed. Setting terminate.\n", id);
-                sh->terminate = 1;
+                LOG("[TA %d] No more exams listed. Setting terminate.\n", id);
+                stop_tas(sh);
                 sem_signal_one(sem_exam);
                 break;
             }
 
-            sh->current_exam_index = next_exam;
+            long long load_start = now_us();
             load_exam(sh, next_exam);
+            record_phase(PHASE_LOAD, now_us() - load_start);
 
             sem_signal_one(sem_exam);
             if (sh->terminate) {
-                printf("[TA %d] Terminate flag set after loading exam. Exiting.\n",
+                LOG("[TA %d] Terminate flag set after loading exam. Exiting.\n",
                        id);
                 break;
             }
         }
     }
 
-    printf("[TA %d, PID %d] Finished.\n", id, getpid());
+    LOG("[TA %d, PID %d] Finished.\n", id, getpid());
+}
+
+// simulation mode: every TA runs ta() as a coroutine in one process.
+// sleeps advance a virtual clock instead of waiting, semaphores are
+// plain counters with FIFO wait queues, and TAs waking at the same
+// virtual time run in an order drawn from the seed, so a seed always
+// gives the same interleaving.
+
+// one simulated TA
+typedef struct {
+    ucontext_t   ctx;
+    char        *stack;
+    long long    wake_us;       // virtual time it runs next
+    unsigned int tiebreak;      // seeded order among TAs waking together
+    unsigned int rng;           // saved ta_rand() state
+    int          done;
+    int          next_waiter;   // next TA blocked on the same semaphore, -1 at end
+} SimTA;
+
+// one simulated semaphore
+typedef struct {
+    int value;
+    int head, tail;             // FIFO of blocked TAs, -1 when empty
+} SimSem;
+
+// recorded grant order of one semaphore, used when replaying
+typedef struct {
+    int *ta;
+    int  len, pos;
+} ReplayQueue;
+
+static SimTA       *sim_tas = NULL;
+static int         *sim_heap = NULL;   // ready TAs, earliest wake time first
+static int          sim_heap_len = 0;
+static SimSem       sim_sems[NUM_SEMS];
+static ReplayQueue  replay[NUM_SEMS];
+static int          replay_on = 0;
+static unsigned int sim_sched_rng = 1;
+static ucontext_t   sim_sched_ctx;
+static long long    sim_events = 0;
+
+// heap order: wake time, then seeded tie-break, then id
+static int sim_before(int a, int b)
+{
+    SimTA *x = &sim_tas[a], *y = &sim_tas[b];
+    if (x->wake_us != y->wake_us) return x->wake_us < y->wake_us;
+    if (x->tiebreak != y->tiebreak) return x->tiebreak < y->tiebreak;
+    return a < b;
+}
+
+// make a TA runnable at virtual time wake_us
+static void sim_ready(int id, long long wake_us)
+{
+    sim_tas[id].wake_us = wake_us;
+    sim_tas[id].tiebreak = (unsigned int)rand_r(&sim_sched_rng);
+
+    int i = sim_heap_len++;
+    sim_heap[i] = id;
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (!sim_before(sim_heap[i], sim_heap[parent])) break;
+        int tmp = sim_heap[i];
+        sim_heap[i] = sim_heap[parent];
+        sim_heap[parent] = tmp;
+        i = parent;
+    }
+}
+
+// take the next TA to run off the heap
+static int sim_pop(void)
+{
+    int top = sim_heap[0];
+    sim_heap[0] = sim_heap[--sim_heap_len];
+
+    int i = 0;
+    while (1) {
+        int l = 2 * i + 1, r = l + 1, m = i;
+        if (l < sim_heap_len && sim_before(sim_heap[l], sim_heap[m])) m = l;
+        if (r < sim_heap_len && sim_before(sim_heap[r], sim_heap[m])) m = r;
+        if (m == i) break;
+        int tmp = sim_heap[i];
+        sim_heap[i] = sim_heap[m];
+        sim_heap[m] = tmp;
+        i = m;
+    }
+    return top;
+}
+
+// hand control back to the scheduler
+static void sim_yield(void)
+{
+    swapcontext(&sim_tas[cur_ta].ctx, &sim_sched_ctx);
+}
+
+static void sim_sleep_us(long long us)
+{
+    sim_ready(cur_ta, sim_clock_us + us);
+    sim_yield();
+}
+
+// may this TA take the semaphore now? only the next recorded
+// grantee may while replaying; anyone may once the trace runs out
+static int replay_turn(int sem, int id)
+{
+    ReplayQueue *q = &replay[sem];
+    return !replay_on || q->pos >= q->len || q->ta[q->pos] == id;
+}
+
+static void replay_advance(int sem)
+{
+    if (replay_on && replay[sem].pos < replay[sem].len) replay[sem].pos++;
+}
+
+// hand a free semaphore to blocked TAs allowed to take it
+static void sim_grant_waiters(int sem)
+{
+    SimSem *s = &sim_sems[sem];
+
+    while (s->value > 0) {
+        int prev = -1, w = s->head;
+        while (w != -1 && !replay_turn(sem, w)) {
+            prev = w;
+            w = sim_tas[w].next_waiter;
+        }
+        if (w == -1) break;
+
+        // unlink w from the wait queue
+        if (prev == -1) s->head = sim_tas[w].next_waiter;
+        else sim_tas[prev].next_waiter = sim_tas[w].next_waiter;
+        if (s->tail == w) s->tail = prev;
+
+        s->value--;
+        replay_advance(sem);
+        sim_ready(w, sim_clock_us);
+    }
+}
+
+// returns 1 if the TA had to block
+static int sim_sem_wait(int sem)
+{
+    SimSem *s = &sim_sems[sem];
+
+    // the parent only takes semaphores before any TA runs
+    if (cur_ta < 0) {
+        s->value--;
+        return 0;
+    }
+
+    if (s->value > 0 && replay_turn(sem, cur_ta)) {
+        s->value--;
+        replay_advance(sem);
+        return 0;
+    }
+
+    // block at the back of the queue; sim_grant_waiters hands the
+    // semaphore over before waking us
+    sim_tas[cur_ta].next_waiter = -1;
+    if (s->tail == -1) s->head = cur_ta;
+    else sim_tas[s->tail].next_waiter = cur_ta;
+    s->tail = cur_ta;
+    sim_yield();
+    return 1;
+}
+
+static void sim_sem_signal(int sem)
+{
+    sim_sems[sem].value++;
+    if (cur_ta >= 0) sim_grant_waiters(sem);
+}
+
+// coroutine body of one simulated TA
+static void sim_entry(int id)
+{
+    ta(id, cur_sh);
+    sim_tas[id].done = 1;
+    // returning resumes sim_sched_ctx through uc_link
+}
+
+// run num_TAs simulated TAs to completion. seeds[] gives each TA's
+// random seed (from a trace); without it seeds are drawn from seed.
+static int sim_run(SharedData *sh, int num_TAs, unsigned int seed,
+                   const unsigned int *seeds)
+{
+    sim_tas = calloc((size_t)num_TAs, sizeof(SimTA));
+    sim_heap = malloc((size_t)num_TAs * sizeof(int));
+    if (!sim_tas || !sim_heap) {
+        perror("malloc simulation");
+        return -1;
+    }
+
+    sim_sched_rng = seed;
+    cur_sh = sh;
+
+    for (int i = 0; i < num_TAs; i++) {
+        SimTA *t = &sim_tas[i];
+        t->stack = malloc(SIM_STACK_SIZE);
+        if (!t->stack) {
+            perror("malloc simulation stack");
+            return -1;
+        }
+        getcontext(&t->ctx);
+        t->ctx.uc_stack.ss_sp = t->stack;
+        t->ctx.uc_stack.ss_size = SIM_STACK_SIZE;
+        t->ctx.uc_link = &sim_sched_ctx;
+        makecontext(&t->ctx, (void (*)(void))sim_entry, 1, i);
+
+        t->rng = seeds ? seeds[i] : (unsigned int)rand_r(&sim_sched_rng);
+        t->next_waiter = -1;
+        sim_ready(i, 0);
+    }
+
+    int finished = 0;
+    while (finished < num_TAs) {
+        if (sim_heap_len == 0) {
+            if (!replay_on) {
+                fprintf(stderr, "[SIM] Deadlock: %d TAs blocked.\n", num_TAs - finished);
+                return -1;
+            }
+            // the run no longer matches the trace; finish unconstrained
+            fprintf(stderr, "[SIM] Replay diverged from trace; continuing unconstrained.\n");
+            replay_on = 0;
+            for (int s = 0; s < NUM_SEMS; s++) sim_grant_waiters(s);
+            continue;
+        }
+
+        int id = sim_pop();
+        SimTA *t = &sim_tas[id];
+        if (t->wake_us > sim_clock_us) sim_clock_us = t->wake_us;
+
+        // switch per-TA globals over to this TA and run it until it blocks
+        cur_ta = id;
+        rng_state = t->rng;
+        my_stats = &sh->ta_stats[id];
+        sim_events++;
+        swapcontext(&sim_sched_ctx, &t->ctx);
+        t->rng = rng_state;
+
+        if (t->done) {
+            free(t->stack);
+            t->stack = NULL;
+            finished++;
+        }
+    }
+
+    cur_ta = -1;
+    my_stats = NULL;
+    free(sim_heap);
+    free(sim_tas);
+    return 0;
+}
+
+// write TA seeds and semaphore grant order of a finished run
+static int save_trace(const char *path, SharedData *sh)
+{
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        perror("fopen trace for write");
+        return -1;
+    }
+
+    int len = sh->trace_len < sh->trace_cap ? sh->trace_len : sh->trace_cap;
+    if (sh->trace_len > sh->trace_cap) {
+        fprintf(stderr, "Trace full; only the first %d grants were kept.\n", sh->trace_cap);
+    }
+
+    fprintf(f, "# TA marking trace: seed <ta> <seed>, grant <ta> <sem>\n");
+    fprintf(f, "tas %d\n", sh->num_tas);
+    for (int t = 0; t < sh->num_tas; t++) {
+        fprintf(f, "seed %d %u\n", t, sh->ta_stats[t].seed);
+    }
+
+    TraceEntry *e = TRACE_ENTRIES(sh);
+    for (int i = 0; i < len; i++) {
+        fprintf(f, "grant %d %d\n", e[i].ta, e[i].sem);
+    }
+
+    fclose(f);
+    return 0;
+}
+
+// read a trace for replay; fills seeds[] and the per-semaphore grant queues
+static int load_trace(const char *path, int num_TAs, unsigned int *seeds)
+{
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror("fopen trace");
+        return -1;
+    }
+
+    char line[128];
+    int tas = -1, cap[NUM_SEMS] = {0};
+    while (fgets(line, sizeof(line), f)) {
+        int a, b;
+        unsigned int u;
+        if (line[0] == '#') continue;
+
+        if (sscanf(line, "tas %d", &a) == 1) {
+            tas = a;
+        } else if (sscanf(line, "seed %d %u", &a, &u) == 2) {
+            if (a >= 0 && a < num_TAs) seeds[a] = u;
+        } else if (sscanf(line, "grant %d %d", &a, &b) == 2) {
+            if (b < 0 || b >= NUM_SEMS || a < 0 || a >= num_TAs) continue;
+            ReplayQueue *q = &replay[b];
+            if (q->len == cap[b]) {
+                cap[b] = cap[b] ? cap[b] * 2 : 256;
+                q->ta = realloc(q->ta, (size_t)cap[b] * sizeof(int));
+                if (!q->ta) {
+                    perror("realloc trace");
+                    fclose(f);
+                    return -1;
+                }
+            }
+            q->ta[q->len++] = a;
+        }
+    }
+    fclose(f);
+
+    if (tas != num_TAs) {
+        fprintf(stderr, "Trace %s is for %d TAs, not %d.\n", path, tas, num_TAs);
+        return -1;
+    }
+    replay_on = 1;
+    return 0;
+}
+
+// value at a given percentile (0-100) of a histogram snapshot, in microseconds.
+// reports the top of the matching bucket, never more than the largest sample.
+static unsigned long long hist_percentile(const unsigned long long buckets[],
+                                          unsigned long long count,
+                                          unsigned long long max, double pct)
+{
+    if (count == 0) return 0;
+
+    unsigned long long target = (unsigned long long)(count * pct / 100.0 + 0.999999);
+    if (target < 1) target = 1;
+
+    unsigned long long seen = 0;
+    unsigned long long value = hist_upper(HIST_BUCKETS - 1);
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += buckets[i];
+        if (seen >= target) {
+            value = hist_upper(i);
+            break;
+        }
+    }
+    return value < max ? value : max;
+}
+
+// print one histogram row
+static void print_hist_row(const char *who, int phase, const unsigned long long snap[],
+                           unsigned long long count, unsigned long long total,
+                           unsigned long long max, double elapsed)
+{
+    printf("%12s %6s %8llu %8.2f %9.1f %9.1f %9.1f %9.1f %9.1f\n",
+           who, phase_names[phase], count, count / elapsed,
+           count ? total / (double)count / 1000.0 : 0.0,
+           hist_percentile(snap, count, max, 50.0) / 1000.0,
+           hist_percentile(snap, count, max, 90.0) / 1000.0,
+           hist_percentile(snap, count, max, 99.0) / 1000.0,
+           max / 1000.0);
+}
+
+// print one snapshot of the histograms, per TA or merged over all TAs
+static void print_stats(SharedData *sh, int per_ta)
+{
+    double elapsed = (now_us() - sh->start_us) / 1e6;
+    if (elapsed <= 0) elapsed = 1e-6;
+
+    printf("[STATS] t=%.1fs exam %d student %s%s\n", elapsed,
+           sh->current_exam_index, sh->current_student,
+           sh->terminate ? " (terminating)" : "");
+    printf("%12s %6s %8s %8s %9s %9s %9s %9s %9s\n",
+           per_ta ? "TA/pid" : "TA", "phase", "count", "rate/s", "mean ms", "p50 ms", "p90 ms", "p99 ms", "max ms");
+
+    unsigned long long marked = 0;
+    unsigned long long all_snap[NUM_PHASES][HIST_BUCKETS];
+    unsigned long long all_count[NUM_PHASES] = {0}, all_max[NUM_PHASES] = {0};
+    unsigned long long all_total[NUM_PHASES] = {0};
+    memset(all_snap, 0, sizeof(all_snap));
+
+    for (int t = 0; t < sh->num_tas; t++) {
+        TAStats *st = &sh->ta_stats[t];
+        for (int p = 0; p < NUM_PHASES; p++) {
+            LatencyHist *h = &st->phase[p];
+
+            // take count first; buckets only ever grow, so the snapshot
+            // holds at least this many samples
+            unsigned long long count = __atomic_load_n(&h->count, __ATOMIC_ACQUIRE);
+            unsigned long long snap[HIST_BUCKETS];
+            for (int i = 0; i < HIST_BUCKETS; i++) {
+                snap[i] = __atomic_load_n(&h->buckets[i], __ATOMIC_RELAXED);
+                all_snap[p][i] += snap[i];
+            }
+            unsigned long long max = __atomic_load_n(&h->max_us, __ATOMIC_RELAXED);
+            unsigned long long total = __atomic_load_n(&h->total_us, __ATOMIC_RELAXED);
+
+            all_count[p] += count;
+            all_total[p] += total;
+            if (max > all_max[p]) all_max[p] = max;
+            if (p == PHASE_MARK) marked += count;
+
+            if (per_ta) {
+                char who[24];
+                snprintf(who, sizeof(who), "%d/%d", t, st->pid);
+                print_hist_row(who, p, snap, count, total, max, elapsed);
+            }
+        }
+    }
+    if (!per_ta) {
+        for (int p = 0; p < NUM_PHASES; p++) {
+            print_hist_row("all", p, all_snap[p], all_count[p], all_total[p],
+                           all_max[p], elapsed);
+        }
+    }
+    printf("[STATS] %llu questions marked, %.2f questions/s overall\n",
+           marked, marked / elapsed);
+    printf("[STATS] answer arena: %u bytes in use, peak %u of %d\n",
+           sh->arena_used, sh->arena_peak, ARENA_SIZE);
+    fflush(stdout);
+}
+
+// stats reader: attach read-only to a running segment and print
+// snapshots every interval seconds until the TAs terminate
+static int stats_main(int argc, char *argv[])
+{
+    int shmid = atoi(argv[2]);
+    int interval = argc > 3 ? atoi(argv[3]) : 2;
+
+    SharedData *sh = (SharedData *)shmat(shmid, NULL, SHM_RDONLY);
+    if (sh == (void *)-1) {
+        perror("shmat stats");
+        return EXIT_FAILURE;
+    }
+
+    // make sure the segment really holds the stats slots it claims to
+    struct shmid_ds ds;
+    if (shmctl(shmid, IPC_STAT, &ds) == -1) {
+        perror("shmctl IPC_STAT");
+        shmdt(sh);
+        return EXIT_FAILURE;
+    }
+    if (sh->num_tas < 0 || sh->trace_cap < 0 ||
+        ds.shm_segsz < SHARED_SIZE(sh->num_tas, sh->trace_cap)) {
+        fprintf(stderr, "Segment %d is not a TA marking segment.\n", shmid);
+        shmdt(sh);
+        return EXIT_FAILURE;
+    }
+
+    while (1) {
+        int done = sh->terminate;
+        print_stats(sh, 1);
+        if (done || interval <= 0) break;
+        sleep(interval);
+    }
+
+    shmdt(sh);
+    return EXIT_SUCCESS;
+}
+
+// simulation mode: run all TAs in this process under a virtual clock
+static int sim_main(int num_TAs, unsigned int seed, const char *replay_path,
+                    const char *record_path)
+{
+    unsigned int *seeds = NULL;
+    if (replay_path) {
+        seeds = calloc((size_t)num_TAs, sizeof(unsigned int));
+        if (!seeds || load_trace(replay_path, num_TAs, seeds) != 0) {
+            fprintf(stderr, "Failed to load trace.\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    int cap = record_path ? TRACE_CAP : 0;
+    size_t size = (SHARED_SIZE(num_TAs, cap) + PAGE_BYTES - 1) / PAGE_BYTES * PAGE_BYTES;
+    SharedData *sh = aligned_alloc(PAGE_BYTES, size);
+    if (!sh) {
+        perror("aligned_alloc shared data");
+        return EXIT_FAILURE;
+    }
+    memset(sh, 0, size);
+    sh->num_tas = num_TAs;
+    sh->trace_cap = cap;
+    sh->start_us = now_us();
+
+    // semaphore ids are just slots into sim_sems[]
+    sem_rubric = SEM_RUBRIC;
+    sem_question = SEM_QUESTION;
+    sem_exam = SEM_EXAM;
+    sem_work = SEM_WORK;
+    for (int s = 0; s < NUM_SEMS; s++) {
+        sim_sems[s].value = s == SEM_WORK ? 0 : 1;
+        sim_sems[s].head = sim_sems[s].tail = -1;
+    }
+    arena_init(sh);
+
+    if (load_rubric(rubric_path, sh) != 0 || load_exam(sh, 0) != 0) {
+        fprintf(stderr, "Failed to load rubric or first exam.\n");
+        return EXIT_FAILURE;
+    }
+
+    long long wall_start = wall_us();
+    if (sim_run(sh, num_TAs, seed, seeds) != 0) {
+        return EXIT_FAILURE;
+    }
+    long long wall = wall_us() - wall_start;
+
+    if (record_path) save_trace(record_path, sh);
+
+    char label[300];
+    if (replay_path) snprintf(label, sizeof(label), "replay of %s", replay_path);
+    else snprintf(label, sizeof(label), "seed %u", seed);
+
+    printf("[SIM] %s: %d TAs, reached exam %d of %d, %lld events, "
+           "%.1fs virtual time in %.1f ms\n",
+           label, num_TAs, sh->current_exam_index + 1, num_exams, sim_events,
+           sim_clock_us / 1e6, wall / 1000.0);
+    print_stats(sh, 0);
+    print_audit(sh);
+
+    free(sh);
+    free(seeds);
+    return EXIT_SUCCESS;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [options] <num_TAs>=2 rubric.txt exam1.txt exam2.txt ...\n"
+            "       %s --stats <shmid> [interval_s]\n"
+            "options:\n"
+            "  --record FILE  save TA seeds and semaphore grant order to FILE\n"
+            "  --sim          run all TAs in one process under a virtual clock\n"
+            "  --seed N       seed for --sim (default 1)\n"
+            "  --replay FILE  simulate the interleaving recorded in FILE\n"
+            "  --exams N      simulate N generated exams instead of exam files\n"
+            "  --quiet        only print summaries\n"
+            "  --mark-ms A:B  mark each question for A to B ms (default 1000:2000)\n"
+            "  --lock-us N    with --sim, each question claim/complete holds the lock N us\n"
+            "  --pin MODE     pin each TA to a cpu or a NUMA node (MODE = cpu | node)\n"
+            "  --mempolicy P  segment placement: local, interleave, bind:N, preferred:N\n"
+            "  --hugepages    back the segment with huge pages\n",
+            prog, prog);
 }
 
 //main function
 int main(int argc, char *argv[])
 {
-    if (argc < 4) {
-        fprintf(stderr,
-                "Usage: %s <num_TAs>=2 rubric.txt exam1.txt exam2.txt ...\n",
-                argv[0]);
+    // stats reader mode: attach to another run's segment
+    if (argc >= 3 && strcmp(argv[1], "--stats") == 0) {
+        return stats_main(argc, argv);
+    }
+
+    static const struct option long_opts[] = {
+        {"record", required_argument, NULL, 'r'},
+        {"sim",    no_argument,       NULL, 's'},
+        {"seed",   required_argument, NULL, 'S'},
+        {"replay", required_argument, NULL, 'p'},
+        {"exams",  required_argument, NULL, 'e'},
+        {"quiet",  no_argument,       NULL, 'q'},
+        {"mark-ms",    required_argument, NULL, 'M'},
+        {"lock-us",    required_argument, NULL, 'L'},
+        {"pin",        required_argument, NULL, 'P'},
+        {"mempolicy",  required_argument, NULL, 'm'},
+        {"hugepages",  no_argument,       NULL, 'H'},
+        {NULL, 0, NULL, 0}
+    };
+    const char *record_path = NULL;
+    const char *replay_path = NULL;
+    unsigned int seed = 1;
+
+    // "+" stops at the first positional argument
+    int opt;
+    while ((opt = getopt_long(argc, argv, "+q", long_opts, NULL)) != -1) {
+        switch (opt) {
+        case 'r': record_path = optarg; break;
+        case 's': sim_mode = 1; break;
+        case 'S': seed = (unsigned int)strtoul(optarg, NULL, 10); break;
+        case 'p': replay_path = optarg; sim_mode = 1; break;
+        case 'e': synthetic_exams = atoi(optarg); break;
+        case 'q': quiet = 1; break;
+        case 'M':
+            if (sscanf(optarg, "%d:%d", &mark_min_ms, &mark_max_ms) != 2 ||
+                mark_min_ms < 0 || mark_max_ms < mark_min_ms) {
+                fprintf(stderr, "--mark-ms must be MIN:MAX with 0 <= MIN <= MAX.\n");
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'L': sim_lock_us = atoll(optarg); break;
+        case 'P':
+            if (strcmp(optarg, "cpu") == 0) pin_mode = PIN_CPU;
+            else if (strcmp(optarg, "node") == 0) pin_mode = PIN_NODE;
+            else {
+                fprintf(stderr, "--pin must be cpu or node.\n");
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'm':
+            if (parse_mem_policy(optarg) != 0) {
+                fprintf(stderr, "Bad --mempolicy '%s'.\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'H': use_hugepages = 1; break;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (synthetic_exams && !sim_mode) {
+        fprintf(stderr, "--exams only works with --sim.\n");
+        return EXIT_FAILURE;
+    }
+    if (sim_lock_us && !sim_mode) {
+        fprintf(stderr, "--lock-us only works with --sim.\n");
+        return EXIT_FAILURE;
+    }
+
+    int npos = argc - optind;
+    if (npos < 3 && !(synthetic_exams > 0 && npos >= 2)) {
+        usage(argv[0]);
         return EXIT_FAILURE;
     }
+    char **args = &argv[optind];
 
-    int num_TAs = atoi(argv[1]);
+    int num_TAs = atoi(args[0]);
     if (num_TAs < 2) {
         fprintf(stderr, "num_TAs must be >= 2.\n");
         return EXIT_FAILURE;
     }
 
-    strncpy(rubric_path, argv[2], sizeof(rubric_path) - 1);
+    strncpy(rubric_path, args[1], sizeof(rubric_path) - 1);
     rubric_path[sizeof(rubric_path) - 1] = '\0';
 
-    num_exams = argc - 3;
-    if (num_exams > MAX_EXAMS) {
-        fprintf(stderr, "Too many exams; max is %d\n", MAX_EXAMS);
-        return EXIT_FAILURE;
+    if (synthetic_exams) {
+        num_exams = synthetic_exams;
+    } else {
+        num_exams = npos - 2;
+        if (num_exams > MAX_EXAMS) {
+            fprintf(stderr, "Too many exams; max is %d\n", MAX_EXAMS);
+            return EXIT_FAILURE;
+        }
+
+        for (int i = 0; i < num_exams; i++) {
+            strncpy(exam_files[i], args[2 + i], sizeof(exam_files[i]) - 1);
+            exam_files[i][sizeof(exam_files[i]) - 1] = '\0';
+        }
     }
 
-    for (int i = 0; i < num_exams; i++) {
-        strncpy(exam_files[i], argv[3 + i], sizeof(exam_files[i]) - 1);
-        exam_files[i][sizeof(exam_files[i]) - 1] = '\0';
+    if (sim_mode) {
+        if (pin_mode != PIN_NONE || mem_policy >= 0 || use_hugepages) {
+            fprintf(stderr, "Placement options are ignored with --sim.\n");
+        }
+        return sim_main(num_TAs, seed, replay_path, record_path);
     }
 
-    // create shared memory
-    int shmid = shmget(IPC_PRIVATE, sizeof(SharedData), IPC_CREAT | 0666);
+    // create shared memory, with room for a trace when recording
+    int trace_cap = record_path ? TRACE_CAP : 0;
+    size_t seg_size = SHARED_SIZE(num_TAs, trace_cap);
+    int shmid = -1;
+
+    if (use_hugepages) {
+        // huge page segments must be a whole number of huge pages
+        size_t hp = huge_page_size();
+        if (hp > 0) {
+            size_t hp_size = (seg_size + hp - 1) / hp * hp;
+            shmid = shmget(IPC_PRIVATE, hp_size, IPC_CREAT | SHM_HUGETLB | 0666);
+        }
+        if (shmid < 0) {
+            perror("shmget huge pages (using normal pages)");
+        }
+    }
+    if (shmid < 0) {
+        shmid = shmget(IPC_PRIVATE, seg_size, IPC_CREAT | 0666);
+    }
     if (shmid < 0) {
         perror("shmget");
         return EXIT_FAILURE;
@@ -358,31 +1847,39 @@ int main(int argc, char *argv[])
         return EXIT_FAILURE;
     }
 
-    memset(sh, 0, sizeof(SharedData));
-    sh->current_exam_index = 0;
-    sh->terminate = 0;
-
-    if (load_rubric(rubric_path, sh) != 0) {
-        fprintf(stderr, "Failed to load rubric.\n");
+    // a huge page segment is bigger than seg_size; cover all of it
+    struct shmid_ds ds;
+    size_t map_size = shmctl(shmid, IPC_STAT, &ds) == 0 ? ds.shm_segsz : seg_size;
+    if (apply_mem_policy(sh, map_size) != 0) {
         shmdt(sh);
         shmctl(shmid, IPC_RMID, NULL);
         return EXIT_FAILURE;
     }
 
-    if (load_exam(sh, 0) != 0) {
-        fprintf(stderr, "Failed to load first exam.\n");
-        shmdt(sh);
-        shmctl(shmid, IPC_RMID, NULL);
-        return EXIT_FAILURE;
-    }
+    // new segments are already zero filled; only clear the header so the
+    // TA stats pages are first touched (and placed) by their own TA. with
+    // --hugepages the header shares a huge page with the slots, so this
+    // memset places all of them and --mempolicy alone decides where
+    memset(sh, 0, sizeof(SharedData));
+    sh->current_exam_index = 0;
+    sh->terminate = 0;
+    sh->num_tas = num_TAs;
+    sh->trace_cap = trace_cap;
+    sh->start_us = now_us();
 
-    // create semaphores
+    printf("[PARENT] Shared memory id %d (live stats: %s --stats %d)\n",
+           shmid, argv[0], shmid);
+
+    arena_init(sh);
+
+    // create semaphores (load_exam() already needs sem_question)
     // 0666 gives read+write permissions to everyone
     sem_rubric = semget(IPC_PRIVATE, 1, IPC_CREAT | 0666);
     sem_question = semget(IPC_PRIVATE, 1, IPC_CREAT | 0666);
     sem_exam = semget(IPC_PRIVATE, 1, IPC_CREAT | 0666);
+    sem_work = semget(IPC_PRIVATE, 1, IPC_CREAT | 0666);
 
-    if (sem_rubric == -1 || sem_question == -1 || sem_exam == -1) {
+    if (sem_rubric == -1 || sem_question == -1 || sem_exam == -1 || sem_work == -1) {
         perror("semget");
         shmdt(sh);
         shmctl(shmid, IPC_RMID, NULL);
@@ -392,6 +1889,22 @@ int main(int argc, char *argv[])
     sem_init_one(sem_rubric, 1);
     sem_init_one(sem_question, 1);
     sem_init_one(sem_exam, 1);
+    sem_init_one(sem_work, 0);
+
+    if (load_rubric(rubric_path, sh) != 0 || load_exam(sh, 0) != 0) {
+        fprintf(stderr, "Failed to load rubric or first exam.\n");
+        shmdt(sh);
+        shmctl(shmid, IPC_RMID, NULL);
+        semctl(sem_rubric, 0, IPC_RMID);
+        semctl(sem_question, 0, IPC_RMID);
+        semctl(sem_exam, 0, IPC_RMID);
+        semctl(sem_work, 0, IPC_RMID);
+        return EXIT_FAILURE;
+    }
+
+    // flush parent output so children don't inherit a copy of the buffer,
+    // and so the shared memory id is visible to a stats reader right away
+    fflush(stdout);
 
     // fork TA processes 
     for (int i = 0; i < num_TAs; i++) {
@@ -405,7 +1918,9 @@ int main(int argc, char *argv[])
                 perror("shmat child");
                 exit(EXIT_FAILURE);
             }
-            // run TA function
+            pin_ta(i);
+            // run TA function, seeded so each TA makes different choices
+            rng_state = (unsigned int)getpid();
             ta(i, child_sh);
             // detach from shared memory and exit
             shmdt(child_sh);
@@ -418,6 +1933,9 @@ int main(int argc, char *argv[])
         wait(NULL);
     }
 
+    if (record_path) save_trace(record_path, sh);
+    print_audit(sh);
+
     // cleanup shared memory 
     shmdt(sh);
     shmctl(shmid, IPC_RMID, NULL);
@@ -426,6 +1944,7 @@ int main(int argc, char *argv[])
     semctl(sem_rubric, 0, IPC_RMID);
     semctl(sem_question, 0, IPC_RMID);
     semctl(sem_exam, 0, IPC_RMID);
+    semctl(sem_work, 0, IPC_RMID);
 
     printf("[PARENT] All TAs finished. Cleanup done.\n");
     return EXIT_SUCCESS;